@@ -0,0 +1,406 @@
+#pragma once
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+
+// Remembers the visited directories ranked by frecency (frequency + recency),
+// same idea as `z` and `zoxide` but built into `cd`, so no process is spawned per directory change.
+//
+// The database is a file of fixed size records mapped into memory (man 2 mmap).
+// Updating a rank is a write to the mapped memory which the kernel flushes to the file on its own.
+// Jumps are answered from an in-memory copy of the paths (with their lowercased versions)
+// and ranks, so no string is built per record while scoring.
+//
+// Every shell that is open maps the same file. Each access takes `flock` on the file,
+// then catches up with what the other shells did: the mapping is redone if the file has grown,
+// and the in-memory copy is rebuilt if the `generation` in the header has moved on.
+class FrecencyDb {
+  public:
+    FrecencyDb(const string& db_path) {
+      fd = open(db_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600); // man 2 open
+      if (fd == -1) {
+        cerr << "Couldn't open the directory history " << db_path << ". errno " << errno << endl;
+        return;
+      }
+      FileLock lock(fd);
+      if (!sync()) {
+        close_db();
+      }
+    }
+
+    ~FrecencyDb() {
+      close_db();
+    }
+
+    void record_visit(const string& dir) {
+      if (fd == -1 || dir.length() > MAX_PATH_LEN) {
+        return;
+      }
+      FileLock lock(fd);
+      if (!sync()) {
+        return;
+      }
+      auto now = static_cast<int64_t>(time(nullptr));
+      auto it = index.find(dir);
+      if (it != index.end()) {
+        Entry& entry = entries[it->second];
+        entry.rank += 1;
+        entry.last_access = now;
+        candidates[it->second].rank = entry.rank;
+        candidates[it->second].last_access = now;
+      } else {
+        if (header->count == mapped_capacity && !grow(max<uint32_t>(INITIAL_CAPACITY, mapped_capacity * 2))) {
+          return;
+        }
+        uint32_t slot = header->count;
+        Entry& entry = entries[slot];
+        entry.last_access = now;
+        entry.rank = 1;
+        entry.path_len = dir.length();
+        memcpy(entry.path, dir.data(), dir.length());
+        header->count += 1;
+        candidates.push_back(make_candidate(entry));
+        index[dir] = slot;
+      }
+      total_rank += 1;
+      if (total_rank > MAX_TOTAL_RANK) {
+        age();
+      }
+      bump_generation();
+    }
+
+    // Finds the highest ranked directory matching all the keywords in order,
+    // with the last one matching the last component of the path.
+    // Case sensitive matches are preferred over case insensitive ones.
+    // `exclude` is usually the cwd, as jumping to where we already are is never what is asked.
+    optional<string> jump(const vector<string>& keywords, const string& exclude) {
+      if (fd == -1 || keywords.empty()) {
+        return nullopt;
+      }
+      FileLock lock(fd);
+      if (!sync()) {
+        return nullopt;
+      }
+      vector<string> lower_keywords;
+      for (const auto& keyword: keywords) {
+        lower_keywords.push_back(to_lower(keyword));
+      }
+      while (true) {
+        auto best = best_match(keywords, lower_keywords, exclude);
+        if (!best.has_value()) {
+          return nullopt;
+        }
+        const string& path = candidates[best.value()].path;
+        struct stat buffer;
+        if (stat(path.c_str(), &buffer) == 0 && S_ISDIR(buffer.st_mode)) {
+          return path;
+        }
+        // the directory is gone, forget it and try the next best
+        remove(best.value());
+        bump_generation();
+      }
+    }
+
+  private:
+    static constexpr uint32_t MAGIC = 0x46524543; // "FREC"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint32_t INITIAL_CAPACITY = 256;
+    // Like `z`, once the ranks add up past this all of them are decayed
+    // so that the old favourites give way to the new ones and the database stays small.
+    static constexpr double MAX_TOTAL_RANK = 9000;
+    static constexpr size_t MAX_PATH_LEN = 242;
+
+    struct Header {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t count;
+      uint32_t capacity;
+      // bumped on every change, so the other shells know to rebuild their in-memory copy
+      uint64_t generation;
+    };
+
+    struct Entry {
+      int64_t last_access;
+      float rank;
+      uint16_t path_len;
+      char path[MAX_PATH_LEN];
+    };
+    static_assert(sizeof(Entry) == 256, "entries must stay fixed size for the mapped file");
+    static_assert(sizeof(Header) % alignof(Entry) == 0, "entries must stay aligned after the header");
+
+    struct Candidate {
+      string path;
+      string lower_path;
+      size_t last_slash;
+      float rank;
+      int64_t last_access;
+    };
+
+    // Holds `flock` on the database for as long as it lives (man 2 flock).
+    // If locking fails the access goes ahead unlocked, as it did for a single shell.
+    struct FileLock {
+      int fd;
+      FileLock(int fd): fd(fd) {
+        while (flock(fd, LOCK_EX) == -1 && errno == EINTR) {}
+      }
+      ~FileLock() {
+        flock(fd, LOCK_UN);
+      }
+    };
+
+    int fd = -1;
+    void* mapping = nullptr;
+    uint32_t mapped_capacity = 0;
+    Header* header = nullptr;
+    Entry* entries = nullptr;
+    uint64_t seen_generation = 0;
+    bool is_synced = false;
+    vector<Candidate> candidates; // same order as the slots in the file
+    unordered_map<string, uint32_t> index; // path -> slot
+    double total_rank = 0;
+
+
+    static size_t mapping_size(uint32_t capacity) {
+      return sizeof(Header) + static_cast<size_t>(capacity) * sizeof(Entry);
+    }
+
+
+    // Catches up with the changes from the other shells. Expects the lock to be held.
+    bool sync() {
+      struct stat buffer;
+      if (fstat(fd, &buffer) == -1) {
+        cerr << "Couldn't read the directory history. errno " << errno << endl;
+        return false;
+      }
+      uint32_t capacity = 0;
+      if (static_cast<size_t>(buffer.st_size) >= sizeof(Header)) {
+        capacity = (buffer.st_size - sizeof(Header)) / sizeof(Entry);
+      }
+      if (capacity == 0) {
+        // a new database, or one without room for a single entry
+        if (!grow(INITIAL_CAPACITY)) {
+          return false;
+        }
+      } else if (capacity != mapped_capacity && !map_file(capacity)) {
+        // another shell has grown the file
+        return false;
+      }
+      if (header->magic != MAGIC || header->version != VERSION || header->count > mapped_capacity) {
+        // new or unreadable database, start from scratch
+        header->magic = MAGIC;
+        header->version = VERSION;
+        header->count = 0;
+        header->capacity = mapped_capacity;
+        header->generation += 1;
+      }
+      if (!is_synced || header->generation != seen_generation) {
+        rebuild_index();
+      }
+      return true;
+    }
+
+
+    bool grow(uint32_t capacity) {
+      if (ftruncate(fd, mapping_size(capacity)) == -1) { // man 2 ftruncate
+        cerr << "Couldn't grow the directory history. errno " << errno << endl;
+        return false;
+      }
+      if (!map_file(capacity)) {
+        return false;
+      }
+      header->capacity = capacity;
+      return true;
+    }
+
+
+    bool map_file(uint32_t capacity) {
+      if (mapping) {
+        munmap(mapping, mapping_size(mapped_capacity));
+      }
+      mapping = mmap(nullptr, mapping_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED) {
+        cerr << "Couldn't map the directory history. errno " << errno << endl;
+        mapping = nullptr;
+        header = nullptr;
+        entries = nullptr;
+        mapped_capacity = 0;
+        return false;
+      }
+      mapped_capacity = capacity;
+      header = static_cast<Header*>(mapping);
+      entries = reinterpret_cast<Entry*>(static_cast<char*>(mapping) + sizeof(Header));
+      return true;
+    }
+
+
+    void close_db() {
+      if (mapping) {
+        munmap(mapping, mapping_size(mapped_capacity));
+        mapping = nullptr;
+        header = nullptr;
+        entries = nullptr;
+      }
+      if (fd != -1) {
+        close(fd);
+        fd = -1;
+      }
+    }
+
+
+    void rebuild_index() {
+      candidates.clear();
+      index.clear();
+      total_rank = 0;
+      for (uint32_t i = 0; i < header->count; i++) {
+        candidates.push_back(make_candidate(entries[i]));
+        index[candidates.back().path] = i;
+        total_rank += entries[i].rank;
+      }
+      seen_generation = header->generation;
+      is_synced = true;
+    }
+
+
+    void bump_generation() {
+      header->generation += 1;
+      seen_generation = header->generation;
+    }
+
+
+    static Candidate make_candidate(const Entry& entry) {
+      string path(entry.path, min<size_t>(entry.path_len, MAX_PATH_LEN));
+      auto last_slash = path.find_last_of('/');
+      return Candidate { path, to_lower(path), last_slash, entry.rank, entry.last_access };
+    }
+
+
+    void remove(uint32_t slot) {
+      // fill the hole with the last entry to keep the records contiguous
+      total_rank -= entries[slot].rank;
+      index.erase(candidates[slot].path);
+      uint32_t last = header->count - 1;
+      if (slot != last) {
+        entries[slot] = entries[last];
+        candidates[slot] = move(candidates[last]);
+        index[candidates[slot].path] = slot;
+      }
+      candidates.pop_back();
+      header->count -= 1;
+    }
+
+
+    void age() {
+      uint32_t i = 0;
+      while (i < header->count) {
+        entries[i].rank *= 0.99;
+        candidates[i].rank = entries[i].rank;
+        if (entries[i].rank < 1) {
+          remove(i); // the last entry is moved into `i`, so check it again
+          continue;
+        }
+        i++;
+      }
+      total_rank = 0;
+      for (uint32_t j = 0; j < header->count; j++) {
+        total_rank += entries[j].rank;
+      }
+    }
+
+
+    // Scores the case sensitive and the case insensitive matches in the same pass.
+    optional<uint32_t> best_match(const vector<string>& keywords, const vector<string>& lower_keywords, const string& exclude) const {
+      auto now = static_cast<int64_t>(time(nullptr));
+      optional<uint32_t> best_exact;
+      optional<uint32_t> best_ignoring_case;
+      double best_exact_score = 0;
+      double best_ignoring_case_score = 0;
+      for (uint32_t i = 0; i < candidates.size(); i++) {
+        const Candidate& candidate = candidates[i];
+        if (candidate.path == exclude) {
+          continue;
+        }
+        // every case sensitive match is also a case insensitive one,
+        // so most of the paths are ruled out with a single check
+        if (!matches(candidate.lower_path, lower_keywords, candidate.last_slash)) {
+          continue;
+        }
+        double score = frecency(candidate, now);
+        if (matches(candidate.path, keywords, candidate.last_slash)) {
+          if (!best_exact.has_value() || score > best_exact_score) {
+            best_exact = i;
+            best_exact_score = score;
+          }
+        } else if (!best_ignoring_case.has_value() || score > best_ignoring_case_score) {
+          best_ignoring_case = i;
+          best_ignoring_case_score = score;
+        }
+      }
+      return best_exact.has_value() ? best_exact : best_ignoring_case;
+    }
+
+
+    static double frecency(const Candidate& candidate, int64_t now) {
+      // same weights as `z`
+      auto age = now - candidate.last_access;
+      if (age < 3600) {
+        return candidate.rank * 4;
+      }
+      if (age < 86400) {
+        return candidate.rank * 2;
+      }
+      if (age < 604800) {
+        return candidate.rank / 2;
+      }
+      return candidate.rank / 4;
+    }
+
+
+    static bool matches(const string& path, const vector<string>& keywords, size_t last_slash) {
+      // Like `zoxide`: the last keyword has to reach into the last component of the path,
+      // so it is matched first, from the right. Searching from the left would stop at
+      // a parent containing the same word, e.g. `proj` in `.../projects/myproj`.
+      const string& last_keyword = keywords.back();
+      auto last_found = path.rfind(last_keyword);
+      if (last_found == string::npos) {
+        return false;
+      }
+      if (last_slash != string::npos && last_found + last_keyword.length() <= last_slash + 1) {
+        return false;
+      }
+      // the rest must show up in order before it
+      size_t pos = 0;
+      for (size_t i = 0; i + 1 < keywords.size(); i++) {
+        auto found = path.find(keywords[i], pos);
+        if (found == string::npos || found + keywords[i].length() > last_found) {
+          return false;
+        }
+        pos = found + keywords[i].length();
+      }
+      return true;
+    }
+
+
+    static string to_lower(string s) {
+      for (auto& c: s) {
+        c = tolower(static_cast<unsigned char>(c));
+      }
+      return s;
+    }
+};
@@ -1,3 +1,4 @@
+#include <fcntl.h>
 #include <iostream>
 #include <string>
 #include <functional>
@@ -8,6 +9,7 @@
 #include <fstream>
 
 #include "myfilesystem.hpp"
+#include "frecency.hpp"
 #include "process.hpp"
 #include "parser.hpp"
 
@@ -17,6 +19,7 @@ using namespace std;
 class JobManager {
   public:
     string cwd;
+    int last_exit_status = 0;
 
     JobManager() {
       myfilesystem::cd_to_home();
@@ -26,19 +29,31 @@ class JobManager {
 
     void run(Job& job) {
       if (is_native_job(job)) {
+        last_exit_status = 0;
         run_native_cmd(job.cmds.front());
         return;
       }
       auto [is_valid_job, error_msg] = verify(job);
       if (!is_valid_job) {
         cout << error_msg << endl;
+        last_exit_status = 127;
         return;
       }
       if (job.cmds.size() == 1) {
-        run_normal_cmd(job.cmds.front(), job.in_bg);
+        last_exit_status = run_normal_cmd(job.cmds.front(), job.in_bg);
         return;
       }
-      run_piped_cmds(job.cmds);
+      last_exit_status = run_piped_cmds(job.cmds);
+    }
+
+
+    void reap_bg_job() {
+      process_mgnr.reap_bg_job();
+    }
+
+
+    int bg_job_count() const {
+      return process_mgnr.bg_job_count();
     }
 
 
@@ -61,6 +76,9 @@ class JobManager {
   private:
     ProcessManager process_mgnr;
     unordered_map<string, function<void (const Command&)>> native_cmd_registry;
+    FrecencyDb frecency_db { myfilesystem::get_home() + "/.shell_frecency" };
+    string prev_cwd;
+    vector<string> dir_stack;
 
 
     void init_native_cmds() {
@@ -68,17 +86,91 @@ class JobManager {
         exit(0);
       };
       native_cmd_registry["pwd"] = [&](const Command&) {
-        cout << myfilesystem::get_cwd() << endl;
+        // the logical path, same as in the prompt, kept up to date by `cd`
+        cout << cwd << endl;
       };
       native_cmd_registry["cd"] = [&](const Command& command) {
-        vector<string> cmd = command.cmd;
+        const vector<string>& cmd = command.cmd;
+        if (cmd.size() == 1) {
+          change_dir("cd", myfilesystem::get_home());
+          return;
+        }
+        if (cmd[1] == "-j") {
+          // z-style jump: `cd -j part1 part2` goes to the most frecent directory matching the parts
+          vector<string> keywords(cmd.begin() + 2, cmd.end());
+          if (keywords.empty()) {
+            cerr << "cd: -j expects at least one part of the directory" << endl;
+            last_exit_status = 1;
+            return;
+          }
+          optional<string> target = frecency_db.jump(keywords, cwd);
+          if (!target.has_value()) {
+            cerr << "cd: no visited directory matches" << endl;
+            last_exit_status = 1;
+            return;
+          }
+          change_dir("cd", target.value());
+          return;
+        }
         if (cmd.size() != 2) {
-          cerr << "Command error: Missing path to change directory" << endl;
+          cerr << "cd: too many arguments" << endl;
+          last_exit_status = 1;
+          return;
+        }
+        if (cmd[1] == "-") {
+          if (prev_cwd.empty()) {
+            cerr << "cd: no previous directory" << endl;
+            last_exit_status = 1;
+            return;
+          }
+          if (change_dir("cd", prev_cwd)) {
+            cout << cwd << endl;
+          }
+          return;
+        }
+        change_dir("cd", cmd[1]);
+      };
+      native_cmd_registry["pushd"] = [&](const Command& command) {
+        const vector<string>& cmd = command.cmd;
+        if (cmd.size() > 2) {
+          cerr << "pushd: too many arguments" << endl;
+          last_exit_status = 1;
           return;
         }
-        string path = cmd[1];
-        myfilesystem::cd(path);
-        cwd = myfilesystem::get_cwd();
+        string from = cwd;
+        if (cmd.size() == 1) {
+          // without a directory swaps the top two directories
+          if (dir_stack.empty()) {
+            cerr << "pushd: no other directory" << endl;
+            last_exit_status = 1;
+            return;
+          }
+          if (!change_dir("pushd", dir_stack.back())) {
+            return;
+          }
+          dir_stack.back() = from;
+        } else {
+          if (!change_dir("pushd", cmd[1])) {
+            return;
+          }
+          dir_stack.push_back(from);
+        }
+        print_dir_stack();
+      };
+      native_cmd_registry["popd"] = [&](const Command&) {
+        if (dir_stack.empty()) {
+          cerr << "popd: directory stack empty" << endl;
+          last_exit_status = 1;
+          return;
+        }
+        if (!change_dir("popd", dir_stack.back())) {
+          return;
+        }
+        dir_stack.pop_back();
+        print_dir_stack();
+      };
+      native_cmd_registry["dirs"] = [&](const Command&) {
+        print_dir_stack();
       };
       native_cmd_registry["test"] = [&](const Command&) {
         cout << "launching sleep" << endl;
@@ -91,16 +183,54 @@ class JobManager {
         process_mgnr.spawn_in_bg("/bin/sleep", command);
       };
       native_cmd_registry["fg"] = [&](const Command&) {
-        process_mgnr.bring2fg();
+        last_exit_status = process_mgnr.bring2fg();
       };
     }
 
 
+    bool change_dir(const string& cmd_name, const string& path) {
+      string target = myfilesystem::resolve_path(cwd, path);
+      if (auto ec = myfilesystem::cd(target)) {
+        cerr << cmd_name << ": " << path << ": " << ec.message() << endl;
+        last_exit_status = 1;
+        return false;
+      }
+      prev_cwd = cwd;
+      // already known, no need to ask the kernel again with `get_cwd()`
+      cwd = target;
+      frecency_db.record_visit(cwd);
+      return true;
+    }
+
+
+    void print_dir_stack() {
+      cout << cwd;
+      for (auto it = dir_stack.rbegin(); it != dir_stack.rend(); it++) {
+        cout << " " << *it;
+      }
+      cout << endl;
+    }
+
+
     void create_pipe(int fds[2]) {
+      // The prompt's worker thread may fork `git` while a pipeline is being set up.
+      // A forked `git` would inherit the write end of the pipe, and the reader
+      // wouldn't get EOF until `git` exits. So the pipe is closed on `execve`,
+      // and the child keeps its end only through `dup2`, which clears the flag (man 2 dup2).
+#ifdef __linux__
+      if (pipe2(fds, O_CLOEXEC) == -1) { // man 2 pipe
+        cerr << "CRASH! pipe2() failed" << endl;
+        exit(1);
+      }
+#else
+      // No `pipe2` in MacOS, leaving a short window between `pipe` and `fcntl`
       if (pipe(fds) == -1) {
         cerr << "CRASH! pipe() failed" << endl;
         exit(1);
       }
+      fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+      fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
     }
 
 
@@ -124,20 +254,19 @@ class JobManager {
 
 
 
-    void run_normal_cmd(const Command& command, bool in_bg) {
+    int run_normal_cmd(const Command& command, bool in_bg) {
       vector<string> cmd = command.cmd;
       optional<string> exec_path = myfilesystem::locate_executable_file_in_path(cmd.front());
       if (in_bg) {
         process_mgnr.spawn_in_bg(exec_path.value(), cmd);
-        return;
+        return 0;
       }
-      process_mgnr.spawn(exec_path.value(), cmd);
-      return;
+      return process_mgnr.spawn(exec_path.value(), cmd);
     }
 
 
 
-    void run_piped_cmds(const vector<Command>& cmds) {
+    int run_piped_cmds(const vector<Command>& cmds) {
       // The pipe buffer in kernel memory is of fixed size.
       // If the data is bigger than the buffer
       // then the data will be written in the buffer in multiple steps.
@@ -188,16 +317,20 @@ class JobManager {
         children.push_back(child_id);
       }
       bool pipeline_failed = false;
+      int last_status = 0;
       for (auto pid: children) {
         int status;
         waitpid(pid, &status, 0);
         if (WEXITSTATUS(status) != 0) {
           pipeline_failed = true; 
         }
+        // like other shells, the pipeline reports the status of its last command
+        last_status = ProcessManager::exit_code(status);
       }
       if (pipeline_failed) {
         cerr << "pipeline failed!" << endl;
       }
+      return last_status;
     }
 
 
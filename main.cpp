@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <string>
@@ -5,6 +6,7 @@
 
 #include "parser.hpp"
 #include "job.hpp"
+#include "prompt.hpp"
 
 
 using namespace std;
@@ -13,9 +15,17 @@ class Shell {
 public:
   void run() {
     string prompt; 
+    chrono::milliseconds last_duration {0};
     while (1) {
-      cout << "[" << job_mgnr.cwd << "]$ ";
-      getline(cin, prompt);
+      job_mgnr.reap_bg_job();
+      prompt_engine.draw(PromptContext {
+        .cwd = job_mgnr.cwd,
+        .last_exit_status = job_mgnr.last_exit_status,
+        .last_duration = last_duration,
+        .job_count = job_mgnr.bg_job_count()
+      });
+      prompt_engine.read_line(prompt);
+      last_duration = chrono::milliseconds {0};
       auto parse_result = parser.parse(prompt);
       if (parse_result.error_msg.has_value()) {
         cout << parse_result.error_msg.value() << endl;
@@ -25,13 +35,16 @@ public:
         continue;
       }
       // job_mgnr.display(parse_result.job.value());
+      auto started_at = chrono::steady_clock::now();
       job_mgnr.run(parse_result.job.value());
+      last_duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started_at);
     }
   }
 
 private:
   Parser parser;
   JobManager job_mgnr;
+  PromptEngine prompt_engine;
 };
 
 
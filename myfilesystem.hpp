@@ -28,8 +28,30 @@ namespace myfilesystem {
     return filesystem::current_path();
   }
 
-  void cd(const string& path) {
-    filesystem::current_path(path);
+  error_code cd(const string& path) {
+    error_code ec;
+    filesystem::current_path(path, ec);
+    return ec;
+  }
+
+  // Works out the new cwd from the current one without asking the kernel,
+  // like the logical `cd` of other shells, so `..` after following a symlink
+  // goes back to where it was followed from.
+  string resolve_path(const string& cwd, const string& path) {
+    filesystem::path target;
+    if (path == "~" || path.rfind("~/", 0) == 0) {
+      target = get_home() + path.substr(1);
+    } else {
+      target = path;
+    }
+    if (target.is_relative()) {
+      target = filesystem::path(cwd) / target;
+    }
+    string resolved = target.lexically_normal();
+    if (resolved.length() > 1 && resolved.back() == '/') {
+      resolved.pop_back();
+    }
+    return resolved;
   }
 
   vector<string> get_path_dirs() {
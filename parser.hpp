@@ -96,7 +96,7 @@ class Parser {
       // Invalid in following cases:
       // - starting with non alphabetic chars for commands
       // - subsequenct occurance of modifier tokens like '|', '>'
-      unordered_set<char> valid_starts = unordered_set<char> {'.', '/', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9'};
+      unordered_set<char> valid_starts = unordered_set<char> {'.', '/', '-', '~', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9'};
       bool modifier_expected_next = false;
       for (int i = 0; i<tokens.size(); i++) {
         auto tok = tokens[i];
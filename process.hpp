@@ -52,7 +52,7 @@ class ProcessManager {
       }
     }
 
-    void spawn(const string& path, const vector<string>& command) {
+    int spawn(const string& path, const vector<string>& command) {
       auto child_pid = fork();
       if (child_pid == -1) {
         cerr << "CRASH! fork() failed" << endl;
@@ -60,6 +60,7 @@ class ProcessManager {
       }
       if (child_pid == 0) {
         execve_child_process(path, command);
+        return 0; // unreachable. Here to supress compiler warning
       } else {
         // In MacOS the SIGTSTP (CTRL + Z) signal is sent to the entire process group.
         // To avoid other processes including the parent receiving the signal
@@ -85,6 +86,7 @@ class ProcessManager {
           set_process_grp_to_fg(getpgrp());
           bg_job = 0;
         }
+        return exit_code(status);
       }
     }
 
@@ -103,7 +105,7 @@ class ProcessManager {
       }
     }
 
-    void bring2fg() {
+    int bring2fg() {
       auto child_pid = bg_job;
       if (child_pid) {
         bg_job = 0;
@@ -125,12 +127,45 @@ class ProcessManager {
             set_process_grp_to_fg(getpgrp());
             bg_job = 0;
         }
+        return exit_code(status);
       }
+      return 0;
+    }
+
+    // Called before each prompt, as nothing else notices a background job exiting
+    // (there is no SIGCHLD handler). Also keeps `bring2fg` from waiting on a pid already gone.
+    void reap_bg_job() {
+      if (!bg_job) {
+        return;
+      }
+      int status;
+      if (waitpid(bg_job, &status, WNOHANG) == bg_job && (WIFEXITED(status) || WIFSIGNALED(status))) { // man 2 waitpid
+        bg_job = 0;
+      }
+    }
+
+    int bg_job_count() const {
+      return bg_job ? 1 : 0;
+    }
+
+    static int exit_code(int status) {
+      // Same convention as other shells for `$?`:
+      // killed or stopped by a signal reports 128 + signal number
+      if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+      }
+      if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+      }
+      if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+      }
+      return 0;
     }
 
 
   private:
-    pid_t bg_job;
+    pid_t bg_job = 0;
 
     void set_process_grp_to_fg(pid_t pid) {
       // Note:
@@ -163,7 +198,7 @@ class ProcessManager {
       signal(SIGTSTP, SIG_DFL);
 
       vector<char*> argv;
-      for (auto c: command) {
+      for (const auto& c: command) {
         argv.push_back(const_cast<char*>(c.c_str()));
       }
       argv.push_back(nullptr);
@@ -0,0 +1,421 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+
+struct PromptContext {
+  string cwd;
+  int last_exit_status;
+  chrono::milliseconds last_duration;
+  int job_count;
+};
+
+
+class PromptEngine {
+  public:
+    PromptEngine() {
+      init_segments();
+      is_tty = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+      // The worker wakes up the main thread through this pipe when the prompt needs a redraw.
+      // Created before the worker thread starts, so nothing can fork in between `pipe` and `fcntl`.
+      if (pipe(wake_fds) == -1) {
+        cerr << "CRASH! pipe() failed" << endl;
+        exit(1);
+      }
+      for (int fd: wake_fds) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+      }
+      // Without a terminal, e.g. a script piped in, nothing is ever redrawn,
+      // so there is no point running `git` for every line.
+      if (is_tty) {
+        worker = thread([this]() { refresh_loop(); });
+      }
+    }
+
+    ~PromptEngine() {
+      {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+      }
+      cv.notify_one();
+      if (worker.joinable()) {
+        worker.join();
+      }
+      close(wake_fds[0]);
+      close(wake_fds[1]);
+    }
+
+    // Draws the prompt right away with whatever the segment caches hold,
+    // possibly stale ones, and hands the context over to the worker thread.
+    // `read_line` redraws the prompt in place if fresher values show up
+    // before the user submits the line.
+    void draw(const PromptContext& ctx) {
+      lock_guard<mutex> lock(mtx);
+      generation += 1;
+      current = ctx;
+      redraw_pending = false;
+      drawn_prompt = render(ctx);
+      drawn_width = display_width(drawn_prompt);
+      awaiting_input = true;
+      cout << drawn_prompt << flush;
+      if (is_tty) {
+        pending = ctx;
+        cv.notify_one();
+      }
+    }
+
+    // Reads the line the user submits after `draw`.
+    // Only this thread writes to the terminal: the worker just asks for a redraw,
+    // and it is done here while no submitted line is pending.
+    void read_line(string& line) {
+      while (is_tty) {
+        pollfd fds[2] = {
+          { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 },
+          { .fd = wake_fds[0], .events = POLLIN, .revents = 0 }
+        };
+        if (poll(fds, 2, -1) == -1) { // man 2 poll
+          if (errno == EINTR) {
+            continue;
+          }
+          break;
+        }
+        // In canonical mode stdin only becomes readable once the user has submitted the line
+        // (or pressed CTRL + D), and by then it is too late to redraw.
+        if (fds[0].revents) {
+          break;
+        }
+        if (fds[1].revents & POLLIN) {
+          char buf[64];
+          while (read(wake_fds[0], buf, sizeof(buf)) > 0) {}
+          lock_guard<mutex> lock(mtx);
+          if (redraw_pending) {
+            redraw_pending = false;
+            redraw(current);
+          }
+        }
+      }
+      getline(cin, line);
+      lock_guard<mutex> lock(mtx);
+      awaiting_input = false;
+    }
+
+  private:
+    struct Segment {
+      string name;
+      // Segments computed on the worker thread are cached per cwd.
+      // A cached value is fresh as long as `cache_key` still returns the same key,
+      // so `cache_key` must be cheap (a few stat calls) while `compute` may be slow.
+      // Without a `cache_key` the cached value is drawn first and then always recomputed.
+      bool is_async;
+      function<string (const PromptContext&)> cache_key;
+      function<string (const PromptContext&)> compute;
+      // put in front of the value in the prompt
+      string separator = " ";
+    };
+
+    struct CacheEntry {
+      string key;
+      string value;
+    };
+
+    vector<Segment> segments;
+    // segment index -> cwd -> cached value
+    vector<unordered_map<string, CacheEntry>> caches;
+
+    mutex mtx;
+    condition_variable cv;
+    thread worker;
+    optional<PromptContext> pending;
+    PromptContext current;
+    unsigned long generation = 0;
+    string drawn_prompt;
+    size_t drawn_width = 0;
+    bool awaiting_input = false;
+    bool redraw_pending = false;
+    int wake_fds[2];
+    bool stopping = false;
+    bool is_tty = false;
+
+
+    void init_segments() {
+      segments.push_back(Segment {
+        .name = "git_branch",
+        .is_async = true,
+        .cache_key = [](const PromptContext& ctx) {
+          optional<string> git_dir = find_git_dir(ctx.cwd);
+          if (!git_dir.has_value()) {
+            return string("");
+          }
+          return git_dir.value() + ":" + to_string(mtime_ns(git_dir.value() + "/HEAD"));
+        },
+        .compute = [](const PromptContext& ctx) {
+          optional<string> git_dir = find_git_dir(ctx.cwd);
+          if (!git_dir.has_value()) {
+            return string("");
+          }
+          return read_git_branch(git_dir.value());
+        }
+      });
+      segments.push_back(Segment {
+        .name = "git_dirty",
+        .is_async = true,
+        // Editing a tracked file touches neither HEAD nor the index,
+        // so there is no cheap key telling whether the worktree changed.
+        .cache_key = nullptr,
+        .compute = [](const PromptContext& ctx) {
+          if (!find_git_dir(ctx.cwd).has_value()) {
+            return string("");
+          }
+          return is_git_worktree_dirty(ctx.cwd) ? string("*") : string("");
+        },
+        .separator = ""
+      });
+      segments.push_back(Segment {
+        .name = "status",
+        .is_async = false,
+        .cache_key = nullptr,
+        .compute = [](const PromptContext& ctx) {
+          return ctx.last_exit_status == 0 ? string("") : "exit:" + to_string(ctx.last_exit_status);
+        }
+      });
+      segments.push_back(Segment {
+        .name = "duration",
+        .is_async = false,
+        .cache_key = nullptr,
+        .compute = [](const PromptContext& ctx) {
+          // only worth showing for the commands that made the user wait
+          auto ms = ctx.last_duration.count();
+          if (ms < 1000) {
+            return string("");
+          }
+          return to_string(ms / 1000) + "." + to_string((ms % 1000) / 100) + "s";
+        }
+      });
+      segments.push_back(Segment {
+        .name = "jobs",
+        .is_async = false,
+        .cache_key = nullptr,
+        .compute = [](const PromptContext& ctx) {
+          return ctx.job_count == 0 ? string("") : "jobs:" + to_string(ctx.job_count);
+        }
+      });
+      caches.resize(segments.size());
+    }
+
+
+    // Expects `mtx` to be held.
+    string render(const PromptContext& ctx) {
+      string prompt = "[" + ctx.cwd;
+      for (size_t i = 0; i < segments.size(); i++) {
+        string value;
+        if (segments[i].is_async) {
+          auto it = caches[i].find(ctx.cwd);
+          if (it != caches[i].end()) {
+            value = it->second.value;
+          }
+        } else {
+          value = segments[i].compute(ctx);
+        }
+        if (!value.empty()) {
+          prompt += segments[i].separator + value;
+        }
+      }
+      return prompt + "]$ ";
+    }
+
+
+    void refresh_loop() {
+      unique_lock<mutex> lock(mtx);
+      while (true) {
+        cv.wait(lock, [this]() { return stopping || pending.has_value(); });
+        if (stopping) {
+          return;
+        }
+        PromptContext ctx = pending.value();
+        pending.reset();
+        auto gen = generation;
+        for (size_t i = 0; i < segments.size(); i++) {
+          if (!segments[i].is_async) {
+            continue;
+          }
+          // Segments are computed without holding the lock,
+          // so the main thread never waits on a slow segment.
+          string key;
+          if (segments[i].cache_key) {
+            lock.unlock();
+            key = segments[i].cache_key(ctx);
+            lock.lock();
+            auto it = caches[i].find(ctx.cwd);
+            if (it != caches[i].end() && it->second.key == key) {
+              continue;
+            }
+          }
+          lock.unlock();
+          string value = segments[i].compute(ctx);
+          lock.lock();
+          caches[i][ctx.cwd] = CacheEntry { key, value };
+          if (stopping) {
+            return;
+          }
+        }
+        // Compared with what is on the screen rather than with the cache before this pass:
+        // a pass for an earlier prompt may have updated the cache after this prompt was drawn.
+        if (gen == generation && awaiting_input && render(ctx) != drawn_prompt) {
+          redraw_pending = true;
+          // if the pipe is full a wake up is already on its way
+          auto n = write(wake_fds[1], "x", 1);
+          (void) n;
+        }
+      }
+    }
+
+
+    // Expects `mtx` to be held. Must only be called from the main thread.
+    void redraw(const PromptContext& ctx) {
+      // Check once more right before writing, in case the user has just pressed enter.
+      // Pressing it in between this check and the write, a few microseconds,
+      // can still put the prompt on the line after the command.
+      // Closing that fully would need the terminal in raw mode with our own line editing.
+      pollfd stdin_fd = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+      if (poll(&stdin_fd, 1, 0) != 0) {
+        return;
+      }
+      // The terminal is in canonical mode, so whatever the user has typed so far
+      // lives in the kernel's line buffer and is only echoed on the screen.
+      // To keep that echoed text intact, the prompt is swapped in place (see `man 4 console_codes`):
+      // save the cursor, go to the start of the line, insert or delete
+      // as many cells as the prompt width changes by (shifting the typed text along),
+      // overwrite the prompt, then restore the cursor shifted by the same amount.
+      // This assumes the prompt and the typed text haven't wrapped past one line.
+      string prompt = render(ctx);
+      if (prompt == drawn_prompt) {
+        return;
+      }
+      size_t width = display_width(prompt);
+      string seq = "\0337\r";
+      if (width > drawn_width) {
+        seq += "\033[" + to_string(width - drawn_width) + "@";
+      } else if (width < drawn_width) {
+        seq += "\033[" + to_string(drawn_width - width) + "P";
+      }
+      seq += prompt + "\0338";
+      if (width > drawn_width) {
+        seq += "\033[" + to_string(width - drawn_width) + "C";
+      } else if (width < drawn_width) {
+        seq += "\033[" + to_string(drawn_width - width) + "D";
+      }
+      drawn_prompt = prompt;
+      drawn_width = width;
+      cout << seq << flush;
+    }
+
+
+    static size_t display_width(const string& s) {
+      // count UTF-8 code points by skipping continuation bytes
+      size_t width = 0;
+      for (unsigned char c: s) {
+        if ((c & 0xC0) != 0x80) {
+          width += 1;
+        }
+      }
+      return width;
+    }
+
+
+    static long long mtime_ns(const string& path) {
+      struct stat buffer;
+      if (stat(path.c_str(), &buffer) != 0) {
+        return 0;
+      }
+#ifdef __APPLE__
+      return buffer.st_mtimespec.tv_sec * 1000000000LL + buffer.st_mtimespec.tv_nsec;
+#else
+      return buffer.st_mtim.tv_sec * 1000000000LL + buffer.st_mtim.tv_nsec;
+#endif
+    }
+
+
+    static optional<string> find_git_dir(const string& cwd) {
+      string dir = cwd;
+      while (true) {
+        struct stat buffer;
+        string candidate = (dir == "/" ? "" : dir) + "/.git";
+        if (stat(candidate.c_str(), &buffer) == 0) {
+          // `.git` is a file for worktrees and submodules, not supported for now
+          return S_ISDIR(buffer.st_mode) ? make_optional(candidate) : nullopt;
+        }
+        if (dir == "/" || dir.empty()) {
+          return nullopt;
+        }
+        auto slash = dir.find_last_of('/');
+        dir = slash == 0 ? "/" : dir.substr(0, slash);
+      }
+    }
+
+
+    static string read_git_branch(const string& git_dir) {
+      // Reading HEAD directly is much cheaper than spawning `git`
+      ifstream head_fs(git_dir + "/HEAD");
+      string head;
+      if (!getline(head_fs, head)) {
+        return "";
+      }
+      const string ref_prefix = "ref: refs/heads/";
+      if (head.rfind(ref_prefix, 0) == 0) {
+        return head.substr(ref_prefix.length());
+      }
+      // detached HEAD
+      return head.substr(0, 7);
+    }
+
+
+    static bool is_git_worktree_dirty(const string& cwd) {
+      // This is the slow part on large repositories,
+      // the reason the segments are computed off the main thread.
+      // `--no-optional-locks` keeps git from taking `.git/index.lock` to refresh the index,
+      // which would make the user's own `git add` or `git commit` fail while this runs.
+      string cmd = "git --no-optional-locks -C '" + escape_single_quotes(cwd) + "' status --porcelain --untracked-files=no 2>/dev/null";
+      FILE* pipe_fs = popen(cmd.c_str(), "r"); // man 3 popen
+      if (!pipe_fs) {
+        return false;
+      }
+      char buf[64];
+      bool dirty = fgets(buf, sizeof(buf), pipe_fs) != nullptr;
+      // drain the rest so that git doesn't get SIGPIPE half way
+      while (fgets(buf, sizeof(buf), pipe_fs) != nullptr) {}
+      pclose(pipe_fs);
+      return dirty;
+    }
+
+
+    static string escape_single_quotes(const string& s) {
+      string escaped;
+      for (char c: s) {
+        if (c == '\'') {
+          escaped += "'\\''";
+        } else {
+          escaped += c;
+        }
+      }
+      return escaped;
+    }
+};
@@ -1,3 +1,3 @@
 #!/bin/sh
 
-clang++ -std=c++20 -g -O0 -Wall main.cpp -o shell && ./shell
+clang++ -std=c++20 -g -O0 -Wall -pthread main.cpp -o shell && ./shell